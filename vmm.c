@@ -44,6 +44,41 @@
  *      of accesses each TLB entry has.  When the TLB is full, I find the TLB entry with the least
  *      number of accesses and replace it next.
  *
+ *      TLB HIERARCHY AND PAGE WALK CACHE
+ *      ---------------------------------
+ *      A miss in the L1 dTLB looks in the larger L2 TLB (LRU replacement in each set), and a miss
+ *      there walks a PAGE_TABLE_LEVELS level page table, each level indexed by PAGE_LEVEL_BITS of the
+ *      page number.  The page walk cache holds recent entries from every level above the leaf, and a
+ *      walk starts below the deepest one it hits.  Each level adds its latency to an estimated total
+ *      of translation cycles.
+ *
+ *      OFFLINE OPT REPLACEMENT
+ *      -----------------------
+ *      In opt mode the whole trace is read first and a next-use index is built for every reference.
+ *      Belady's OPT (evict the entry used furthest in the future) is then run for the frames, the TLB
+ *      and the TLB hierarchy with a max-heap keyed by next use, giving a lower bound to compare LRU and
+ *      LFU with.  The L1 and L2 TLB are not inclusive, so together they hold up to TLB_ENTRIES plus
+ *      TLB_L2_ENTRIES pages, and OPT with that many entries bounds the misses in both (the page walks).
+ *
+ *      TIERED PHYSICAL MEMORY
+ *      ----------------------
+ *      Physical memory is split into MEMORY_TIERS tiers, fastest first, sized by TIER_FRAMES with the
+ *      access costs in TIER_LATENCIES.  New pages go into the fastest tier with a free frame.  Between
+ *      references, every MIGRATION_INTERVAL, each pair of adjacent tiers is balanced: pages that are hot
+ *      (by numTimesAccessed) in the slower tier are promoted one tier up, swapping with the coldest pages
+ *      there to make room.  I sum the cost of every access to get the time weighted cost.
+ *
+ *      ADAPTIVE FRAME ALLOCATION
+ *      -------------------------
+ *      A trace line may end with a process id, each process has its own address space (they all map
+ *      BACKING_STORE.bin) and a working set estimator, WS(tau) over its last WS_WINDOW references, and
+ *      samples its page fault frequency every PFF_INTERVAL references.  With ADAPTIVE_ALLOCATION each
+ *      process starts with a fair share of the frames as its quota, which protects its working set from
+ *      replacement by the other processes.  Each interval the quota follows WS(tau), growing faster
+ *      when the fault frequency is high, with frames taken from processes that have more frames than
+ *      their working set, or from thrashing processes down to their fair share.  When the fault frequency is high, the quota can not grow and the working set does not fit (or,
+ *      with the static pool, the working sets of all processes do not fit), I report thrashing.
+ *
  */
 int main(int argc, char *argv[] ) {
 
@@ -53,8 +88,9 @@ int main(int argc, char *argv[] ) {
 	*   The following variables are used:
 	* 
 	*   address - The Virtual address read from the file         
+	*   pid     - The process that made the reference
 	*   currentFrame = The current physical frame
-	*   pageNumber - The decoded page number (0 to 255)
+	*   pageNumber - The decoded page number, pid*PAGE_ENTRIES plus the page in the address (0 to 255)
 	*   offset     - The decoded offset (0 to 255)
 	*   myInt      - A temporary integer variable
 	*   aFrame     - A temporary physical frame
@@ -63,58 +99,63 @@ int main(int argc, char *argv[] ) {
 	*   numPageHits - The total number of page hits
 	*   numTblHits - The total number of Table hits
 	*   numTblMisses - The total number of table misses
+	*   numTlbL2Hits - The total number of L2 TLB hits
+	*   numTlbL2Misses - The total number of L2 TLB misses
+	*   translationCycles - The estimated number of cycles spent translating addresses
+	*   pageFault  - TRUE if this address reference caused a page fault
 	*/
-    unsigned int address, currentFrame=START_FRAME, pageNumber, offset, myInt;
+    unsigned int address, pid, currentFrame=START_FRAME, pageNumber, offset, myInt;
     int aFrame, numPageFaults=0, numAddressLookups=0, numPageHits=0, numTlbHits=0, numTlbMisses=0;
+    int numTlbL2Hits=0, numTlbL2Misses=0;
+    long long translationCycles=0;
     /* This is the page table */
     pageTableType pageTable;
     /* This is what I used to represent Physical Memory */
     physicalMemoryType physicalMemory;
     /* This is my TLB */
     tlbType tlb;
-    int mode=0, arguments;
-    char accessType;
-    BOOLEAN done=FALSE, addressWrite=FALSE;
+    /* These are the working sets of the processes */
+    workingSetType workingSets[MAX_PROCESSES];
+    /* This is my page walk cache */
+    pageWalkCacheType pageWalkCache;
+    int mode=0;
+    char accessType, line[MAX_LINE_LENGTH];
+    BOOLEAN done=FALSE, addressWrite=FALSE, pageFault;
 
     if ( argc != 3 ) /* argc should be 2 for correct execution */
     {
         /* We print argv[0] assuming it is the program name */
-        printf( "usage: %s [read or write] filename", argv[0] );
+        printf( "usage: %s [read, write or opt] filename", argv[0] );
         exit(1);
     }
     if (strcmp(argv[1], "read") == 0 ) mode = READ;
     if (strcmp(argv[1], "write") == 0 ) mode = WRITE;
+    if (strcmp(argv[1], "opt") == 0 ) mode = OPT;
 
     printf("Running with file %s, in mode", argv[2]);
     if (mode == READ) printf(" read only capable.\n");
     if (mode == WRITE) printf(" write capable.\n");
+    if (mode == OPT) {
+    	printf(" offline OPT.\n");
+    	run_opt(argv[2]);
+    	return EXIT_SUCCESS;
+    }
 
-    initialize(&pageTable, &physicalMemory, &tlb);
+    initialize(&pageTable, &physicalMemory, &tlb, workingSets, &pageWalkCache);
     dump_page_table(&pageTable);
     dump_tlb(&tlb);
 
 	file=fopen(argv[2], "r");
 
-	while (!feof(file))
+	while (fgets(line, MAX_LINE_LENGTH, file) != NULL)
 	{
-		if (mode == READ) {
-		   arguments = fscanf(file, "%d", &address);
-		   if (arguments != 1) {
-			   done=TRUE;
-		   }
+		done = !parse_trace_line(line, &address, &accessType, &pid);
+		if (DEBUG_LEVEL_3) printf("address=%d, accessType=%c, pid=%d.\n", address, accessType, pid);
+		if ((mode == WRITE) && (accessType == 'W')) {
+		   addressWrite = TRUE;
 		}
-		if (mode == WRITE) {
-		   arguments = fscanf(file, "%d %c", &address, &accessType);
-		   if (arguments != 2) {
-		   	   done=TRUE;
-		   }
-		   if (DEBUG_LEVEL_3) printf("address=%d, accessType=%c.\n", address, accessType);
-		   if (accessType == 'W') {
-			   addressWrite = TRUE;
-		   }
-		   else {
-			   addressWrite = FALSE;
-		   }
+		else {
+		   addressWrite = FALSE;
 		}
 
        if (!done) {
@@ -122,12 +163,15 @@ int main(int argc, char *argv[] ) {
 		   if (DEBUG_LEVEL_2) printf("%d \n", address);
 		   /* Translate Logical to Physical Address */
 		   numAddressLookups++; /* Sum the total instructions, used for LRU algorithm */
-		   pageNumber=extract_pagenumber(address);
+		   pageNumber=(pid*PAGE_ENTRIES)+extract_pagenumber(address);
 		   offset=extract_offset(address);
+		   pageFault=FALSE;
+		   activate_process(workingSets, pid);
 
 		   /* Do a TLB Lookup */
 		   if (DEBUG_LEVEL_2) printf("Doing lookup in TLB for pageNumber %d.\n", pageNumber);
 		   aFrame=lookup_tlb(&tlb, pageNumber);
+		   translationCycles+=TLB_L1_LATENCY;
 
 		   if (DEBUG_LEVEL_2) printf("\nVirtual Address   (decimal=%5u), Physical Address = %d\n", address, ((currentFrame*FRAME_SIZE)+offset));
 		   /* showbits(address);*/
@@ -139,29 +183,28 @@ int main(int argc, char *argv[] ) {
 		   /* If the TLB misses */
 		   if (aFrame == -1) {
 			  numTlbMisses++; /* Sum the number of TLB misses */
-			  /* Do a Page Table Lookup */
-			  aFrame=lookup_frame(&pageTable, pageNumber);
-
-			  if (DEBUG_LEVEL_2) printf("After TLB Miss, aFrame=%d.\n", aFrame);
+			  /* Do a L2 TLB Lookup, and walk the page table if it misses too */
+			  translationCycles+=TLB_L2_LATENCY;
+			  aFrame=lookup_tlb_l2(&tlb, pageNumber);
 			  if (aFrame == -1) {
-				  insert_tlb(&tlb, pageNumber, currentFrame); /* Insert the correct information into TLB */
+				  numTlbL2Misses++;
+				  translationCycles+=page_walk(&pageWalkCache, pageNumber);
+				  /* Do a Page Table Lookup */
+				  aFrame=lookup_frame(&pageTable, pageNumber);
 			  }
 			  else {
-				  insert_tlb(&tlb, pageNumber, aFrame); /* Insert the correct information into TLB */
+				  numTlbL2Hits++;
 			  }
 
-			  if (DEBUG_LEVEL_2) printf("TLB Lookup failed, pageNumber=%d, currentFrame=%d.\n", pageNumber, currentFrame);
-
-			  /* Do a Page Table Lookup */
-			  aFrame=lookup_frame(&pageTable, pageNumber);
-			  if (DEBUG_LEVEL_2) printf("aFrame=%d.\n",aFrame);
+			  if (DEBUG_LEVEL_2) printf("TLB Lookup failed, pageNumber=%d, aFrame=%d.\n", pageNumber, aFrame);
 
          	  /* if (pageTable.validInvalidBit[pageNumber] == FALSE) { */
          	  /* This is a Page Fault */
 		      if (aFrame == -1) {
-		    	 page_fault(&pageTable, pageNumber, &physicalMemory, &currentFrame);
+		    	 page_fault(&pageTable, pageNumber, &physicalMemory, &tlb, workingSets, &currentFrame);
 		      	 aFrame=lookup_frame(&pageTable, pageNumber);
 		      	 numPageFaults++;
+		      	 pageFault=TRUE;
 		      	 /* Let's keep track of Address Counter, used for LRU algorithm */
 		      	 if (DEBUG_LEVEL_1) printf("\nPAGE-MISS for address %d, page=%d, frame=%d.",address, pageNumber, aFrame);
 		      	 if (DEBUG_LEVEL_2) printf("(Page-MISS)-Storing address counter (%d) in lruCounter for frame (%d)\n", numAddressLookups, aFrame);
@@ -174,7 +217,6 @@ int main(int argc, char *argv[] ) {
 		      else {
 		    	 /* This is a page HIT */
 		         numPageHits++;
-	      	     aFrame=lookup_frame(&pageTable, pageNumber);
 	      		 if (DEBUG_LEVEL_2) printf("(Page-HIT)-Storing address counter (%d) in lruCounter for frame (%d)", numAddressLookups, aFrame);
 	      		 physicalMemory.lruCounter[aFrame] = numAddressLookups;
 	      		 if (DEBUG_LEVEL_1) printf("\nPAGE-HIT for address %d, page=%d, frame=%d.\n",address, pageNumber, aFrame);
@@ -183,21 +225,30 @@ int main(int argc, char *argv[] ) {
 	      	        if (addressWrite == WRITE) printf("\nMarking frame %d dirty, address access at %d is Write.\n", aFrame, address);
 	      		 }
 	      	  }
+		      /* Insert the correct information into TLB, now that the page is resident */
+		      insert_tlb(&tlb, pageNumber, aFrame);
+		      insert_tlb_l2(&tlb, pageNumber, aFrame);
 		   }
 		   else {
 			  /* This is a TBL Hit */
 			  if (DEBUG_LEVEL_1) printf("\nTLB-HIT for address %d, page=%d, frame=%d.",address, pageNumber, aFrame);
 			  numTlbHits++;
+			  physicalMemory.lruCounter[aFrame] = numAddressLookups;
 			  if (addressWrite == WRITE) physicalMemory.dirty[aFrame]=TRUE;
 			  if (DEBUG_LEVEL_1) {
    		         if (addressWrite == WRITE) printf("\nMarking frame %d dirty, address access at %d is Write.\n", aFrame, address);
 			  }
 		   }
+		   /* Track the working set, and resize the frame quota at the end of each interval */
+		   update_working_set(&workingSets[pid], pageNumber%PAGE_ENTRIES, pageFault);
+		   adjust_frame_quota(workingSets, pid, numAddressLookups);
+
 		   if (DEBUG_LEVEL_2) dump_tlb(&tlb);
 		   if (DEBUG_LEVEL_2) dump_page_table(&pageTable);
 		   if (DEBUG_LEVEL_2) dump_physical_memory(&physicalMemory);
 
 		   /* We now know the TBL and the Page Table are upto date */
+		   record_memory_access(&physicalMemory, aFrame);
 		   myInt = physicalMemory.physicalMemory[(aFrame*FRAME_SIZE)+offset];
 		   if (DEBUG_LEVEL_2) {
 			   printf("\n****Virtual Address: %5u, Physical Address = %d, ", address, ((aFrame*FRAME_SIZE)+offset));
@@ -207,6 +258,10 @@ int main(int argc, char *argv[] ) {
 			   printf("\nVirtual address: %u Physical address: %d ", address, ((aFrame*FRAME_SIZE)+offset));
 			   printf("Value: %d", myInt);
 		   }
+		   /* Migrate hot and cold pages between the memory tiers in the background */
+		   if ((numAddressLookups%MIGRATION_INTERVAL) == 0) {
+			   migrate_pages(&pageTable, &physicalMemory, &tlb);
+		   }
 		   if (DEBUG_LEVEL_2) printf("+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n\n\n");
        }
 	}
@@ -215,24 +270,34 @@ int main(int argc, char *argv[] ) {
 	printf("\n\nNumber of address lookups=%d.\n", numAddressLookups);
 	printf("Number of TLB misses=%d.\n", numTlbMisses);
 	printf("Number of TLB hits=%d.\n", numTlbHits);
+	printf("Number of L2 TLB misses=%d.\n", numTlbL2Misses);
+	printf("Number of L2 TLB hits=%d.\n", numTlbL2Hits);
+	printf("Number of page walk cache misses=%d.\n", pageWalkCache.misses);
+	printf("Number of page walk cache hits=%d.\n", pageWalkCache.hits);
+	printf("Number of page walk memory references=%d.\n", pageWalkCache.memoryReferences);
+	printf("Estimated translation cycles=%lld, average per lookup=%.2f.\n", translationCycles,
+			(numAddressLookups > 0) ? ((double)translationCycles/numAddressLookups) : 0.0);
 	printf("Number of page faults=%d.\n", numPageFaults);
 	printf("Number of page hits=%d.\n", numPageHits);
+	print_working_set_stats(workingSets);
+	print_tier_stats(&physicalMemory, numAddressLookups);
 
 	return EXIT_SUCCESS;
 }
 
 /*
  * Function Name - lookup_tlb
- * Purpose       - To lookup the TLB entry that matches page number.
+ * Purpose       - To lookup the L1 TLB entry that matches page number, only the set the page maps to is searched.
  * Parameters    - tlbType *tlb - This is the TLB (translation look-aside buffer)
  *                 pageNumber   - This is the page number to search for in the TLB.
  * Returns       - Returns the TLB entry that matches, or -1 if no match.
  */
 int lookup_tlb(tlbType *tlb, unsigned int pageNumber)
 {
-	int i=0, frameNumber;
+	int i=0, frameNumber, firstEntry;
 	if (DEBUG_LEVEL_2) printf("Searching TLB for pageNumber %d.\n", pageNumber);
-	for (i=0;i<TLB_ENTRIES;i++)
+	firstEntry=(pageNumber%TLB_L1_SETS)*TLB_L1_WAYS;
+	for (i=firstEntry;i<(firstEntry+TLB_L1_WAYS);i++)
 	{
 		/* printf("i=%d, tlb->inUse[i]=%d, tlb->page[i]=%d, tlb->frame[i]=%d.\n",i, tlb->inUse[i],tlb->page[i], tlb->frame[i]);*/
 		if (tlb->inUse[i] == TRUE) {
@@ -251,7 +316,7 @@ int lookup_tlb(tlbType *tlb, unsigned int pageNumber)
 
 /*
  * Function Name - insert_tlb
- * Purpose       - To insert an element into the TLB.
+ * Purpose       - To insert an element into the L1 TLB, in the set the page maps to.
  * Parameters    - tlbType *tlb - This is the TLB (translation look-aside buffer)
  *                 pageNumber   - This is the page number to insert in the TLB.
  *                 currentFrame - This is the frame to insert into the TLB
@@ -260,10 +325,12 @@ int lookup_tlb(tlbType *tlb, unsigned int pageNumber)
 void insert_tlb(tlbType *tlb, unsigned int pageNumber, unsigned int currentFrame)
 {
 
-	int i=0, leastUsed;
+	int i=0, leastUsed, firstEntry;
 	BOOLEAN inserted=FALSE;
 
-    while ((i < TLB_ENTRIES) && (inserted == FALSE))
+	firstEntry=(pageNumber%TLB_L1_SETS)*TLB_L1_WAYS;
+	i=firstEntry;
+    while ((i < (firstEntry+TLB_L1_WAYS)) && (inserted == FALSE))
     {
     	if (tlb->inUse[i] == TRUE) {
     		i++;
@@ -280,7 +347,7 @@ void insert_tlb(tlbType *tlb, unsigned int pageNumber, unsigned int currentFrame
     if (!(inserted))
     {
     	if (DEBUG_LEVEL_2) printf("TLB is full.\n");
-    	leastUsed=least_used_tlb_entry(tlb);
+    	leastUsed=least_used_tlb_entry(tlb, pageNumber);
     	if (DEBUG_LEVEL_2) printf("Inserting page number %d into TLB entry %d, frame=%d.\n",pageNumber, leastUsed, currentFrame);
     	tlb->inUse[leastUsed]=TRUE;
     	tlb->page[leastUsed]=pageNumber;
@@ -290,20 +357,199 @@ void insert_tlb(tlbType *tlb, unsigned int pageNumber, unsigned int currentFrame
 }
 
 
+/*
+ * Function Name - invalidate_tlb
+ * Purpose       - To remove the TLB entry for a page that is no longer resident in physical memory
+ * Parameters    - tlbType *tlb - This is the TLB (translation look-aside buffer)
+ *                 pageNumber   - This is the page number to remove from the TLB.
+ * Returns       - Nothing
+ */
+void invalidate_tlb(tlbType *tlb, unsigned int pageNumber)
+{
+	int i;
+	for (i=0;i<TLB_ENTRIES;i++) {
+		if ((tlb->inUse[i] == TRUE) && (tlb->page[i] == pageNumber)) {
+			if (DEBUG_LEVEL_2) printf("Invalidating TLB entry %d for page number %d.\n", i, pageNumber);
+			tlb->inUse[i]=FALSE;
+			tlb->numTimesUsed[i]=0;
+		}
+	}
+	for (i=0;i<TLB_L2_ENTRIES;i++) {
+		if ((tlb->l2InUse[i] == TRUE) && (tlb->l2Page[i] == pageNumber)) {
+			if (DEBUG_LEVEL_2) printf("Invalidating L2 TLB entry %d for page number %d.\n", i, pageNumber);
+			tlb->l2InUse[i]=FALSE;
+		}
+	}
+}
+
+
+/*
+ * Function Name - lookup_tlb_l2
+ * Purpose       - To lookup the L2 TLB entry that matches page number, only the set the page maps to is searched.
+ * Parameters    - tlbType *tlb - This is the TLB (translation look-aside buffer)
+ *                 pageNumber   - This is the page number to search for in the L2 TLB.
+ * Returns       - Returns the frame of the L2 TLB entry that matches, or -1 if no match.
+ */
+int lookup_tlb_l2(tlbType *tlb, unsigned int pageNumber)
+{
+	int i, firstEntry;
+	firstEntry=(pageNumber%TLB_L2_SETS)*TLB_L2_WAYS;
+	for (i=firstEntry;i<(firstEntry+TLB_L2_WAYS);i++) {
+		if ((tlb->l2InUse[i] == TRUE) && (tlb->l2Page[i] == pageNumber)) {
+			tlb->l2LastUsed[i]=++(tlb->l2Clock);
+			if (DEBUG_LEVEL_2) printf("L2 TLB Hit: pageNumber=%d, frameNumber=%d.\n", pageNumber, tlb->l2Frame[i]);
+			return tlb->l2Frame[i];
+		}
+	}
+	if (DEBUG_LEVEL_2) printf("L2 TLB Miss: pageNumber=%d.\n", pageNumber);
+	return -1;
+}
+
+
+/*
+ * Function Name - insert_tlb_l2
+ * Purpose       - To insert an element into the L2 TLB, replacing the least recently used entry of the set
+ *                 when the set is full.  If the page is already in the L2 TLB its entry is refreshed.
+ * Parameters    - tlbType *tlb - This is the TLB (translation look-aside buffer)
+ *                 pageNumber   - This is the page number to insert in the L2 TLB.
+ *                 currentFrame - This is the frame to insert into the L2 TLB
+ * Returns       - Nothing
+ */
+void insert_tlb_l2(tlbType *tlb, unsigned int pageNumber, unsigned int currentFrame)
+{
+	int i, firstEntry, victim=-1;
+	firstEntry=(pageNumber%TLB_L2_SETS)*TLB_L2_WAYS;
+	for (i=firstEntry;i<(firstEntry+TLB_L2_WAYS);i++) {
+		if ((tlb->l2InUse[i] == TRUE) && (tlb->l2Page[i] == pageNumber)) {
+			victim=i;
+			break;
+		}
+		if (tlb->l2InUse[i] == FALSE) {
+			if ((victim == -1) || (tlb->l2InUse[victim] == TRUE)) victim=i;
+		}
+		else if ((victim == -1) || ((tlb->l2InUse[victim] == TRUE) && (tlb->l2LastUsed[i] < tlb->l2LastUsed[victim]))) {
+			victim=i;
+		}
+	}
+	if (DEBUG_LEVEL_2) printf("Inserting page number %d into L2 TLB entry %d, frame=%d.\n", pageNumber, victim, currentFrame);
+	tlb->l2InUse[victim]=TRUE;
+	tlb->l2Page[victim]=pageNumber;
+	tlb->l2Frame[victim]=currentFrame;
+	tlb->l2LastUsed[victim]=++(tlb->l2Clock);
+}
+
+
+/*
+ * Function Name - page_walk
+ * Purpose       - To estimate the cost of walking the page table for a page.  The page walk cache is searched
+ *                 for the deepest upper level entry of the page, the levels below it each cost a memory
+ *                 reference (all PAGE_TABLE_LEVELS levels on a miss) and the upper level entries read are
+ *                 inserted into the page walk cache.  A single level page table has no upper levels, so
+ *                 the walk is one memory reference and the page walk cache is not used.
+ * Parameters    - pageWalkCache - This is the page walk cache
+ *                 pageNumber - This is the page number being translated
+ * Returns       - Returns the number of cycles the walk took
+ */
+int page_walk(pageWalkCacheType *pageWalkCache, unsigned int pageNumber)
+{
+	int level, hitLevel=-1, references;
+
+	if (PAGE_TABLE_LEVELS == 1) {
+		pageWalkCache->memoryReferences++;
+		return MEMORY_LATENCY;
+	}
+	/* The leaf level is PAGE_TABLE_LEVELS-1, only the levels above it are cached */
+	for (level=PAGE_TABLE_LEVELS-2;level>=0;level--) {
+		if (lookup_pwc(pageWalkCache, level, pageNumber>>(PAGE_LEVEL_BITS*(PAGE_TABLE_LEVELS-1-level)))) {
+			hitLevel=level;
+			break;
+		}
+	}
+	if (hitLevel == -1) {
+		pageWalkCache->misses++;
+	}
+	else {
+		pageWalkCache->hits++;
+	}
+	for (level=hitLevel+1;level<=PAGE_TABLE_LEVELS-2;level++) {
+		insert_pwc(pageWalkCache, level, pageNumber>>(PAGE_LEVEL_BITS*(PAGE_TABLE_LEVELS-1-level)));
+	}
+	references=PAGE_TABLE_LEVELS-1-hitLevel;
+	if (DEBUG_LEVEL_2) printf("Page walk for page %d, page walk cache hit at level %d, %d memory references.\n", pageNumber, hitLevel, references);
+	pageWalkCache->memoryReferences+=references;
+	return PWC_LATENCY+(references*MEMORY_LATENCY);
+}
+
+
+/*
+ * Function Name - lookup_pwc
+ * Purpose       - To lookup an upper level page table entry in the page walk cache, only the set it maps to is
+ *                 searched
+ * Parameters    - pageWalkCache - This is the page walk cache
+ *                 level - This is the page table level of the entry
+ *                 prefix - These are the page number bits that index down to the entry
+ * Returns       - Returns TRUE if the entry is in the page walk cache
+ */
+BOOLEAN lookup_pwc(pageWalkCacheType *pageWalkCache, int level, unsigned int prefix)
+{
+	int i, firstEntry;
+	firstEntry=(((prefix*PAGE_TABLE_LEVELS)+level)%PWC_SETS)*PWC_WAYS;
+	for (i=firstEntry;i<(firstEntry+PWC_WAYS);i++) {
+		if ((pageWalkCache->inUse[i] == TRUE) && (pageWalkCache->level[i] == level) && (pageWalkCache->prefix[i] == prefix)) {
+			pageWalkCache->lastUsed[i]=++(pageWalkCache->clock);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
+/*
+ * Function Name - insert_pwc
+ * Purpose       - To insert an upper level page table entry into the page walk cache, replacing the least
+ *                 recently used entry of the set when the set is full
+ * Parameters    - pageWalkCache - This is the page walk cache
+ *                 level - This is the page table level of the entry
+ *                 prefix - These are the page number bits that index down to the entry
+ * Returns       - Nothing
+ */
+void insert_pwc(pageWalkCacheType *pageWalkCache, int level, unsigned int prefix)
+{
+	int i, firstEntry, victim;
+	firstEntry=(((prefix*PAGE_TABLE_LEVELS)+level)%PWC_SETS)*PWC_WAYS;
+	victim=firstEntry;
+	for (i=firstEntry;i<(firstEntry+PWC_WAYS);i++) {
+		if (pageWalkCache->inUse[i] == FALSE) {
+			if (pageWalkCache->inUse[victim] == TRUE) victim=i;
+		}
+		else if ((pageWalkCache->inUse[victim] == TRUE) && (pageWalkCache->lastUsed[i] < pageWalkCache->lastUsed[victim])) {
+			victim=i;
+		}
+	}
+	if (DEBUG_LEVEL_2) printf("Inserting level %d entry %d into page walk cache entry %d.\n", level, prefix, victim);
+	pageWalkCache->inUse[victim]=TRUE;
+	pageWalkCache->level[victim]=level;
+	pageWalkCache->prefix[victim]=prefix;
+	pageWalkCache->lastUsed[victim]=++(pageWalkCache->clock);
+}
+
+
 /*
  * Function Name - least_used_tlb_entry
- * Purpose       - To return the least used TLB entry (by number of accesses)
+ * Purpose       - To return the least used TLB entry (by number of accesses) in the set the page maps to
  * Parameters    - tlbType *tlb - This is the TLB (translation look-aside buffer)
+ *                 pageNumber   - This is the page number being inserted
  * Returns       - Returns the least used TLB entry (by number of accesses)
  */
 
-int least_used_tlb_entry(tlbType *tlb)
+int least_used_tlb_entry(tlbType *tlb, unsigned int pageNumber)
 {
-	int i;
+	int i, firstEntry;
 	unsigned int leastUsed, numUsed;
-	leastUsed = 0;
+	firstEntry=(pageNumber%TLB_L1_SETS)*TLB_L1_WAYS;
+	leastUsed = firstEntry;
 	numUsed = tlb->numTimesUsed[leastUsed];
-	for (i=1;i<TLB_ENTRIES;i++) {
+	for (i=firstEntry+1;i<(firstEntry+TLB_L1_WAYS);i++) {
 		if (tlb->numTimesUsed[i] < numUsed) {
 			leastUsed = i;
 			numUsed = tlb->numTimesUsed[leastUsed];
@@ -323,22 +569,11 @@ int least_used_tlb_entry(tlbType *tlb)
  */
 int lookup_frame(pageTableType *pageTable, unsigned int pageNumber)
 {
-	int i;
-	if (DEBUG_LEVEL_2) printf("In lookup_frame, searching for pageNumber=%d.\n", pageNumber);
-	for (i=0;i<PAGE_ENTRIES;i++)
-	{
-		if (pageTable->pageTable[i] == pageNumber) {
-			if (pageTable->validInvalidBit[i] == TRUE) {
-				if (DEBUG_LEVEL_2) printf("Found page table entry for pageNumber %d, frame is %d.\n", pageNumber, pageTable->frameTable[i]);
-				return pageTable->frameTable[i];
-			}
-			else {
-				if (pageNumber > 0) {
-				   printf("ERROR: Invalid page entry.\n");
-				   exit(1);
-				}
-			}
-		}
+	if (DEBUG_LEVEL_2) printf("In lookup_frame, looking up pageNumber=%d.\n", pageNumber);
+	/* page_fault always stores a page at its own index in the page table */
+	if (pageTable->validInvalidBit[pageNumber] == TRUE) {
+		if (DEBUG_LEVEL_2) printf("Found page table entry for pageNumber %d, frame is %d.\n", pageNumber, pageTable->frameTable[pageNumber]);
+		return pageTable->frameTable[pageNumber];
 	}
 	return -1;
 }
@@ -346,49 +581,325 @@ int lookup_frame(pageTableType *pageTable, unsigned int pageNumber)
 
 /*
  * Function Name - page_fault
- * Purpose       - To execute a page fault, which will load from the store into physical memory
+ * Purpose       - To execute a page fault, which will load from the store into physical memory.  A free
+ *                 frame in the fastest tier that has one is used, and if memory is full the global LRU
+ *                 frame is evicted first, or with ADAPTIVE_ALLOCATION the LRU frame that is not protected
+ *                 by its owner's frame quota.
  * Parameters    - pageTable - This is the page table
  *                 pageNumber   - This is the page number that caused the page fault
  *                 physicalMemory - This is the physical memory that I load into
- *                 currentFrame - This is the frame to load into page table
+ *                 tlb - This is the TLB, entries for an evicted page are invalidated
+ *                 workingSets - These are the working sets holding the frame quotas
+ *                 currentFrame - Set to the frame the page was loaded into
  * Returns       - Nothing
  */
 void page_fault(pageTableType *pageTable, unsigned int pageNumber,
-		physicalMemoryType *physicalMemory, unsigned int *currentFrame)
+		physicalMemoryType *physicalMemory, tlbType *tlb, workingSetType *workingSets, unsigned int *currentFrame)
 {
+	unsigned int lruFrame, pid;
+	int i, residentFrames=0;
+
 	if (DEBUG_LEVEL_2) printf("Page Fault on Page Table Entry %d, currentFrame=%d.\n", pageNumber, *currentFrame);
+	pid=pageNumber/PAGE_ENTRIES;
+	for (i=0;i<MAX_PROCESSES;i++) {
+		residentFrames+=workingSets[i].residentFrames;
+	}
+	if (residentFrames >= FRAME_ENTRIES) {
+		if (ADAPTIVE_ALLOCATION) {
+			lruFrame=find_over_quota_lru_frame(physicalMemory, workingSets, pid);
+			if (physicalMemory->pageInFrame[lruFrame]/PAGE_ENTRIES != pid) {
+				workingSets[physicalMemory->pageInFrame[lruFrame]/PAGE_ENTRIES].framesReleased++;
+			}
+		}
+		else {
+			lruFrame=find_lru_frame(physicalMemory, -1);
+		}
+		evict_frame(pageTable, physicalMemory, tlb, workingSets, lruFrame);
+		*currentFrame = lruFrame;
+		if (DEBUG_LEVEL_2) printf("Physical memory full, pageNumber=%d, currentFrame=%d, lruFrame=%d.\n", pageNumber, (*currentFrame), lruFrame);
+	}
+	else {
+		*currentFrame = find_free_frame(physicalMemory);
+	}
 	load_page_from_backing_store(pageNumber, physicalMemory, currentFrame);
+	physicalMemory->pageInFrame[(*currentFrame)]=pageNumber;
+	workingSets[pid].residentFrames++;
 	pageTable->pageTable[pageNumber]=pageNumber;
 	pageTable->validInvalidBit[pageNumber]=TRUE;
 	pageTable->frameTable[pageNumber]=*currentFrame;
-	(*currentFrame)++;
+}
+
+/*
+ * Function Name - evict_frame
+ * Purpose       - To remove a page from physical memory, writing it to swap if it is dirty, and
+ *                 invalidating its page table and TLB entries
+ * Parameters    - pageTable - This is the page table
+ *                 physicalMemory - This is the physical memory holding the frame
+ *                 tlb - This is the TLB
+ *                 workingSets - These are the working sets, one of them owns the frame
+ *                 frame - This is the frame to evict
+ * Returns       - Nothing
+ */
+void evict_frame(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb,
+		workingSetType *workingSets, unsigned int frame)
+{
+	unsigned int victimPage;
+
+	victimPage=physicalMemory->pageInFrame[frame];
+	if (DEBUG_LEVEL_2) printf("Evicting page %d from frame %d, dirty bit is %d.\n", victimPage, frame, physicalMemory->dirty[frame]);
+	if (physicalMemory->dirty[frame] == TRUE) {
+		if (DEBUG_LEVEL_1) printf("Frame is dirty, it has been written too, writing to swap.\n");
+		physicalMemory->dirty[frame] = FALSE;
+	}
+	pageTable->validInvalidBit[victimPage]=FALSE;
+	pageTable->pageTable[victimPage]=0;
+	pageTable->frameTable[victimPage]=0;
+	invalidate_tlb(tlb, victimPage);
+	physicalMemory->frameInUse[frame]=FALSE;
+	physicalMemory->numTimesAccessed[frame]=0;
+	workingSets[victimPage/PAGE_ENTRIES].residentFrames--;
 }
 
 /*
  * Function Name - find_lru_frame
  * Purpose       - To find the Least Recently Used frame in the physical memory
  * Parameters    - physicalMemory - This is the physical memory that I search for Least Recently Used
+ *                 pid - Only frames owned by this process are searched, or -1 to search every frame
  * Returns       - Returns the Least Recently Used frame
  */
 
-unsigned int find_lru_frame(physicalMemoryType *physicalMemory)
+unsigned int find_lru_frame(physicalMemoryType *physicalMemory, int pid)
 {
-	int i, lruFrame=0;
+	int i, lruFrame=-1;
 	for (i=0;i<FRAME_ENTRIES;i++)
 	{
-		if (physicalMemory->lruCounter[i] < physicalMemory->lruCounter[lruFrame])
-		{
-			lruFrame = i;
+		if ((physicalMemory->frameInUse[i] == TRUE) &&
+			((pid == -1) || ((int)(physicalMemory->pageInFrame[i]/PAGE_ENTRIES) == pid))) {
+			if ((lruFrame == -1) || (physicalMemory->lruCounter[i] < physicalMemory->lruCounter[lruFrame]))
+			{
+				lruFrame = i;
+			}
 		}
 	}
+	if (lruFrame == -1) {
+		printf("ERROR: No frame in use to replace.\n");
+		exit(1);
+	}
 	if (DEBUG_LEVEL_2) printf("Found LRU Page=%d, dirty bit is %d.\n", lruFrame, physicalMemory->dirty[lruFrame]);
-	if (physicalMemory->dirty[lruFrame] == TRUE) {
-		if (DEBUG_LEVEL_1) printf("Frame is dirty, it has been written too, writing to swap.\n");
-		physicalMemory->dirty[lruFrame] == FALSE;
+	return lruFrame;
+}
+
+/*
+ * Function Name - find_over_quota_lru_frame
+ * Purpose       - To find the Least Recently Used frame that is not protected by a frame quota.  A frame is
+ *                 protected when its page is in the working set of a process within its quota, the faulting
+ *                 process only counts as within its quota while it has fewer frames than its quota.
+ * Parameters    - physicalMemory - This is the physical memory that I search for Least Recently Used
+ *                 workingSets - These are the working sets holding the frame quotas
+ *                 faulting - This is the process that needs a frame
+ * Returns       - Returns the Least Recently Used unprotected frame
+ */
+
+unsigned int find_over_quota_lru_frame(physicalMemoryType *physicalMemory, workingSetType *workingSets,
+		unsigned int faulting)
+{
+	int i, lruFrame=-1;
+	unsigned int pid;
+	for (i=0;i<FRAME_ENTRIES;i++)
+	{
+		if (physicalMemory->frameInUse[i] == FALSE) continue;
+		pid=physicalMemory->pageInFrame[i]/PAGE_ENTRIES;
+		if ((workingSets[pid].residentFrames > workingSets[pid].frameQuota) ||
+			((pid == faulting) && (workingSets[pid].residentFrames >= workingSets[pid].frameQuota)) ||
+			(workingSets[pid].windowCount[physicalMemory->pageInFrame[i]%PAGE_ENTRIES] == 0)) {
+			if ((lruFrame == -1) || (physicalMemory->lruCounter[i] < physicalMemory->lruCounter[lruFrame]))
+			{
+				lruFrame = i;
+			}
+		}
+	}
+	if (lruFrame == -1) {
+		printf("ERROR: Every frame is protected by a frame quota.\n");
+		exit(1);
 	}
+	if (DEBUG_LEVEL_2) printf("Found over quota LRU Page=%d, dirty bit is %d.\n", lruFrame, physicalMemory->dirty[lruFrame]);
 	return lruFrame;
 }
 
+/*
+ * Function Name - find_free_frame
+ * Purpose       - To find a frame that is not in use, in the fastest memory tier that has one
+ * Parameters    - physicalMemory - This is the physical memory that I search for a free frame
+ * Returns       - Returns the free frame
+ */
+
+unsigned int find_free_frame(physicalMemoryType *physicalMemory)
+{
+	int i;
+	/* The tiers are laid out in order from frame 0, fastest first */
+	for (i=0;i<FRAME_ENTRIES;i++)
+	{
+		if (physicalMemory->frameInUse[i] == FALSE) {
+			return i;
+		}
+	}
+	printf("ERROR: No free frame in physical memory.\n");
+	exit(1);
+}
+
+/*
+ * Function Name - frame_tier
+ * Purpose       - To find the memory tier a frame belongs to
+ * Parameters    - physicalMemory - This is the physical memory
+ *                 frame - This is the frame
+ * Returns       - Returns the tier of the frame
+ */
+
+int frame_tier(physicalMemoryType *physicalMemory, unsigned int frame)
+{
+	int tier;
+	for (tier=MEMORY_TIERS-1;tier>0;tier--)
+	{
+		if ((int)frame >= physicalMemory->tierFirstFrame[tier]) break;
+	}
+	return tier;
+}
+
+/*
+ * Function Name - record_memory_access
+ * Purpose       - To count an access to a frame, for hot page detection, and add its tier's access cost
+ * Parameters    - physicalMemory - This is the physical memory
+ *                 frame - This is the frame that was accessed
+ * Returns       - Nothing
+ */
+
+void record_memory_access(physicalMemoryType *physicalMemory, unsigned int frame)
+{
+	int tier;
+	tier=frame_tier(physicalMemory, frame);
+	physicalMemory->numTimesAccessed[frame]++;
+	physicalMemory->tierAccesses[tier]++;
+	physicalMemory->accessCost+=physicalMemory->tierLatency[tier];
+}
+
+/*
+ * Function Name - migrate_pages
+ * Purpose       - The background migration pass.  For each pair of adjacent tiers, fastest first, the hottest
+ *                 pages in the slower tier (accessed at least HOT_THRESHOLD times) are promoted into a free
+ *                 frame of the faster tier, or swapped with the coldest page of the faster tier if that page is
+ *                 colder.  Afterwards the access counts are halved so hotness follows recent accesses.
+ * Parameters    - pageTable - This is the page table
+ *                 physicalMemory - This is the physical memory
+ *                 tlb - This is the TLB, entries for migrated pages are invalidated
+ * Returns       - Nothing
+ */
+
+void migrate_pages(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb)
+{
+	int i, n, tier, fastFirst, fastLast, slowLast, hotFrame, coldFrame, freeFrame;
+
+	for (tier=0;tier<(MEMORY_TIERS-1);tier++) {
+		fastFirst=physicalMemory->tierFirstFrame[tier];
+		fastLast=fastFirst+physicalMemory->tierFrames[tier];
+		slowLast=fastLast+physicalMemory->tierFrames[tier+1];
+		for (n=0;n<MIGRATION_BATCH;n++) {
+			hotFrame=-1;
+			for (i=fastLast;i<slowLast;i++) {
+				if ((physicalMemory->frameInUse[i] == TRUE) && (physicalMemory->numTimesAccessed[i] >= HOT_THRESHOLD)) {
+					if ((hotFrame == -1) || (physicalMemory->numTimesAccessed[i] > physicalMemory->numTimesAccessed[hotFrame])) {
+						hotFrame=i;
+					}
+				}
+			}
+			if (hotFrame == -1) break;
+
+			freeFrame=-1;
+			coldFrame=-1;
+			for (i=fastFirst;i<fastLast;i++) {
+				if (physicalMemory->frameInUse[i] == FALSE) {
+					freeFrame=i;
+					break;
+				}
+				if ((coldFrame == -1) ||
+					(physicalMemory->numTimesAccessed[i] < physicalMemory->numTimesAccessed[coldFrame]) ||
+					((physicalMemory->numTimesAccessed[i] == physicalMemory->numTimesAccessed[coldFrame]) &&
+					 (physicalMemory->lruCounter[i] < physicalMemory->lruCounter[coldFrame]))) {
+					coldFrame=i;
+				}
+			}
+			if (freeFrame != -1) {
+				swap_frames(pageTable, physicalMemory, tlb, hotFrame, freeFrame);
+			}
+			else if ((coldFrame != -1) && (physicalMemory->numTimesAccessed[coldFrame] < physicalMemory->numTimesAccessed[hotFrame])) {
+				swap_frames(pageTable, physicalMemory, tlb, hotFrame, coldFrame);
+				physicalMemory->demotions++;
+			}
+			else {
+				break;
+			}
+			physicalMemory->promotions++;
+		}
+	}
+
+	for (i=0;i<FRAME_ENTRIES;i++) {
+		physicalMemory->numTimesAccessed[i]/=2;
+	}
+}
+
+/*
+ * Function Name - swap_frames
+ * Purpose       - To move the page in one frame to another frame, and the page in that frame (if any) back
+ *                 the other way.  The page table is updated, and the TLB entries of the moved pages invalidated.
+ * Parameters    - pageTable - This is the page table
+ *                 physicalMemory - This is the physical memory
+ *                 tlb - This is the TLB
+ *                 fromFrame - This is the frame to move from, it must be in use
+ *                 toFrame - This is the frame to move to
+ * Returns       - Nothing
+ */
+
+void swap_frames(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb,
+		unsigned int fromFrame, unsigned int toFrame)
+{
+	char buffer[FRAME_SIZE];
+	BOOLEAN toInUse, dirty;
+	int numTimesAccessed, lruCounter;
+	unsigned int page;
+
+	toInUse=physicalMemory->frameInUse[toFrame];
+	if (DEBUG_LEVEL_2) printf("Migrating page %d from frame %d to frame %d.\n", physicalMemory->pageInFrame[fromFrame], fromFrame, toFrame);
+
+	memcpy(buffer, &physicalMemory->physicalMemory[toFrame*FRAME_SIZE], FRAME_SIZE);
+	memcpy(&physicalMemory->physicalMemory[toFrame*FRAME_SIZE], &physicalMemory->physicalMemory[fromFrame*FRAME_SIZE], FRAME_SIZE);
+	memcpy(&physicalMemory->physicalMemory[fromFrame*FRAME_SIZE], buffer, FRAME_SIZE);
+
+	page=physicalMemory->pageInFrame[toFrame];
+	physicalMemory->pageInFrame[toFrame]=physicalMemory->pageInFrame[fromFrame];
+	physicalMemory->pageInFrame[fromFrame]=page;
+	dirty=physicalMemory->dirty[toFrame];
+	physicalMemory->dirty[toFrame]=physicalMemory->dirty[fromFrame];
+	physicalMemory->dirty[fromFrame]=dirty;
+	numTimesAccessed=physicalMemory->numTimesAccessed[toFrame];
+	physicalMemory->numTimesAccessed[toFrame]=physicalMemory->numTimesAccessed[fromFrame];
+	physicalMemory->numTimesAccessed[fromFrame]=numTimesAccessed;
+	lruCounter=physicalMemory->lruCounter[toFrame];
+	physicalMemory->lruCounter[toFrame]=physicalMemory->lruCounter[fromFrame];
+	physicalMemory->lruCounter[fromFrame]=lruCounter;
+	physicalMemory->frameInUse[toFrame]=TRUE;
+	physicalMemory->frameInUse[fromFrame]=toInUse;
+
+	page=physicalMemory->pageInFrame[toFrame];
+	pageTable->frameTable[page]=toFrame;
+	invalidate_tlb(tlb, page);
+	physicalMemory->migrationCost+=MIGRATION_COST;
+	if (toInUse) {
+		page=physicalMemory->pageInFrame[fromFrame];
+		pageTable->frameTable[page]=fromFrame;
+		invalidate_tlb(tlb, page);
+		physicalMemory->migrationCost+=MIGRATION_COST;
+	}
+}
+
 /*
  * Function Name - load_page_from_backing_store
  * Purpose       - To load an actual 256 bytes from the backing store
@@ -404,25 +915,18 @@ void load_page_from_backing_store(unsigned int pageNumber, physicalMemoryType *p
 	FILE *file;
 	char buffer[PAGE_SIZE];
 	int fileLocater;
-	fileLocater=pageNumber*PAGE_SIZE;
+	fileLocater=(pageNumber%PAGE_ENTRIES)*PAGE_SIZE; /* Every process maps the same backing store */
 	int i, elementsRead, locationOfFrame;
-	unsigned int lruFrame;
 
 	if (DEBUG_LEVEL_2) printf("Reading page #%d from BACKING_STORE.bin at location %d, currentFrame=%d.\n", pageNumber, fileLocater, (*currentFrame));
 
-	if (physicalMemory->frameInUse[(FRAME_ENTRIES-1)] == TRUE) {
-		lruFrame=find_lru_frame(physicalMemory);
-		*currentFrame = lruFrame;
-		if (DEBUG_LEVEL_2) printf("Memory Full, pageNumber=%d, currentFrame=%d, lruFrame=%d.\n", pageNumber, (*currentFrame), lruFrame);
-	}
-
 	file=fopen("BACKING_STORE.bin", "r");
 	fseek(file, fileLocater, SEEK_SET);
 	elementsRead=fread(buffer, 1, FRAME_SIZE, file);
 	if (DEBUG_LEVEL_2) printf("Elements read = %d.\n",elementsRead);
 	/* print_page(buffer); */
 	physicalMemory->frameInUse[(*currentFrame)]=TRUE;
-	physicalMemory->numTimesAccessed[(*currentFrame)]=1;
+	physicalMemory->numTimesAccessed[(*currentFrame)]=0;
 	/* Copy the buffer read from BACKING STORE into Physical Memory */
 	locationOfFrame=(*currentFrame)*FRAME_SIZE;
 
@@ -441,14 +945,19 @@ void load_page_from_backing_store(unsigned int pageNumber, physicalMemoryType *p
  * Parameters    - pageTable - This is the page table
  *                 physicalMemory - This is the physical memory that I load into
  *                 tlb - This is the TLB
+ *                 workingSets - These are the working sets of the processes
+ *                 pageWalkCache - This is the page walk cache
  * Returns       - Nothing
  */
 
-void initialize(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb)
+void initialize(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb, workingSetType *workingSets,
+		pageWalkCacheType *pageWalkCache)
 {
-	int i;
+	int i, pid, frames;
+	int tierFrames[MEMORY_TIERS]=TIER_FRAMES, tierLatencies[MEMORY_TIERS]=TIER_LATENCIES;
+	workingSetType *workingSet;
 	if (DEBUG_LEVEL_2) printf("Initializing Page Table, setting all valid-Invalid bit's to invalid.\n");
-	for (i=0;i<PAGE_ENTRIES;i++) {
+	for (i=0;i<VIRTUAL_PAGES;i++) {
 		pageTable->validInvalidBit[i]=FALSE;  /* Set validInvalid bit to Invalid (0) */
 		pageTable->pageTable[i]=0;
 		pageTable->frameTable[i]=0;
@@ -461,10 +970,668 @@ void initialize(pageTableType *pageTable, physicalMemoryType *physicalMemory, tl
 		physicalMemory->frameInUse[i] = FALSE;
 		physicalMemory->dirty[i] = FALSE;
 		physicalMemory->numTimesAccessed[i]=0;
+		physicalMemory->lruCounter[i]=0;
+		physicalMemory->pageInFrame[i]=0;
+	}
+	if (DEBUG_LEVEL_2) printf("Initializing %d memory tiers.\n", MEMORY_TIERS);
+	frames=0;
+	for (i=0;i<MEMORY_TIERS;i++) {
+		if (tierFrames[i] < 1) {
+			printf("ERROR: Memory tier %d has no frames.\n", i);
+			exit(1);
+		}
+		physicalMemory->tierFirstFrame[i]=frames;
+		physicalMemory->tierFrames[i]=tierFrames[i];
+		physicalMemory->tierLatency[i]=tierLatencies[i];
+		physicalMemory->tierAccesses[i]=0;
+		frames+=tierFrames[i];
+	}
+	if (frames != FRAME_ENTRIES) {
+		printf("ERROR: The memory tiers have %d frames, not FRAME_ENTRIES (%d).\n", frames, FRAME_ENTRIES);
+		exit(1);
 	}
+	physicalMemory->accessCost=0;
+	physicalMemory->migrationCost=0;
+	physicalMemory->promotions=0;
+	physicalMemory->demotions=0;
 	for (i=0;i<TLB_ENTRIES;i++) {
 		tlb->inUse[i]=FALSE;
 	}
+	for (i=0;i<TLB_L2_ENTRIES;i++) {
+		tlb->l2InUse[i]=FALSE;
+		tlb->l2LastUsed[i]=0;
+	}
+	tlb->l2Clock=0;
+	for (i=0;i<PWC_ENTRIES;i++) {
+		pageWalkCache->inUse[i]=FALSE;
+		pageWalkCache->lastUsed[i]=0;
+	}
+	pageWalkCache->clock=0;
+	pageWalkCache->hits=0;
+	pageWalkCache->misses=0;
+	pageWalkCache->memoryReferences=0;
+	if (DEBUG_LEVEL_2) printf("Initializing working sets, processes have no frame quota until they run.\n");
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		workingSet=&workingSets[pid];
+		for (i=0;i<PAGE_ENTRIES;i++) {
+			workingSet->windowCount[i]=0;
+		}
+		workingSet->active=FALSE;
+		workingSet->references=0;
+		workingSet->windowNext=0;
+		workingSet->windowFill=0;
+		workingSet->workingSetSize=0;
+		workingSet->peakWorkingSetSize=0;
+		workingSet->workingSetSum=0;
+		workingSet->frameQuota=0;
+		workingSet->residentFrames=0;
+		workingSet->intervalAccesses=0;
+		workingSet->intervalFaults=0;
+		workingSet->thrashing=FALSE;
+		workingSet->thrashingIntervals=0;
+		workingSet->quotaIncreases=0;
+		workingSet->quotaDecreases=0;
+		workingSet->framesReleased=0;
+	}
+}
+
+
+/*
+ * Function Name - parse_trace_line
+ * Purpose       - To read one reference from a line of a trace file.  The line is an address, then an
+ *                 optional access type (R or W), then an optional process id.
+ * Parameters    - line - The line read from the trace file
+ *                 address - Set to the virtual address
+ *                 accessType - Set to the access type, or 'R' if there is none
+ *                 pid - Set to the process id, or 0 if there is none
+ * Returns       - Returns TRUE if the line holds a reference, FALSE if it does not
+ */
+
+BOOLEAN parse_trace_line(char *line, unsigned int *address, char *accessType, unsigned int *pid)
+{
+	char *next, *end;
+
+	*address=(unsigned int)strtoul(line, &end, 10);
+	if (end == line) return FALSE;
+	next=end;
+	while ((*next == ' ') || (*next == '\t')) next++;
+	*accessType='R';
+	if ((*next == 'R') || (*next == 'W')) {
+		*accessType=*next;
+		next++;
+	}
+	*pid=(unsigned int)strtoul(next, &end, 10);
+	if (end == next) *pid=0;
+	if (*pid >= MAX_PROCESSES) {
+		printf("ERROR: Process id %u is not less than %d.\n", *pid, MAX_PROCESSES);
+		exit(1);
+	}
+	return TRUE;
+}
+
+
+/*
+ * Function Name - update_working_set
+ * Purpose       - To add a reference to the working set window, WS(tau) is the number of distinct
+ *                 pages referenced in the last WS_WINDOW references
+ * Parameters    - workingSet - This is the working set
+ *                 pageNumber - This is the page that was referenced
+ *                 pageFault - TRUE if the reference caused a page fault
+ * Returns       - Nothing
+ */
+
+void update_working_set(workingSetType *workingSet, unsigned int pageNumber, BOOLEAN pageFault)
+{
+	unsigned int oldPage;
+
+	/* Slide the oldest reference out of the window once it is full */
+	if (workingSet->windowFill == WS_WINDOW) {
+		oldPage=workingSet->window[workingSet->windowNext];
+		workingSet->windowCount[oldPage]--;
+		if (workingSet->windowCount[oldPage] == 0) workingSet->workingSetSize--;
+	}
+	else {
+		workingSet->windowFill++;
+	}
+	workingSet->window[workingSet->windowNext]=pageNumber;
+	if (workingSet->windowCount[pageNumber] == 0) workingSet->workingSetSize++;
+	workingSet->windowCount[pageNumber]++;
+	workingSet->windowNext=(workingSet->windowNext+1)%WS_WINDOW;
+
+	if (workingSet->workingSetSize > workingSet->peakWorkingSetSize) {
+		workingSet->peakWorkingSetSize=workingSet->workingSetSize;
+	}
+	workingSet->workingSetSum+=workingSet->workingSetSize;
+	workingSet->references++;
+	workingSet->intervalAccesses++;
+	if (pageFault) workingSet->intervalFaults++;
+}
+
+
+/*
+ * Function Name - activate_process
+ * Purpose       - To start a process the first time it makes a reference.  With ADAPTIVE_ALLOCATION its
+ *                 frame quota is its fair share, from unassigned frames first and then taken from the
+ *                 processes with more than their fair share.
+ * Parameters    - workingSets - These are the working sets of the processes
+ *                 pid - This is the process making the reference
+ * Returns       - Nothing
+ */
+
+void activate_process(workingSetType *workingSets, unsigned int pid)
+{
+	int share, frames;
+
+	if (workingSets[pid].active) return;
+	workingSets[pid].active=TRUE;
+	if (ADAPTIVE_ALLOCATION) {
+		share=fair_share(workingSets);
+		frames=unassigned_frames(workingSets);
+		if (frames > share) frames=share;
+		if (frames < share) {
+			frames+=reclaim_frames(workingSets, pid, share-frames, TRUE);
+		}
+		workingSets[pid].frameQuota=frames;
+		if (DEBUG_LEVEL_1) printf("\nProcess %d started with a frame quota of %d.", pid, frames);
+	}
+}
+
+
+/*
+ * Function Name - reclaim_frames
+ * Purpose       - To take frames from the quotas of other processes for a process that needs them.  A frame
+ *                 is taken from the process with the most frames above its floor, which is its working set
+ *                 (and MIN_FRAME_QUOTA), or its fair share if its working set does not fit in its quota.
+ *                 When forced, every floor is the fair share.  The frames stay resident until a process
+ *                 under its quota needs them, see page_fault.
+ * Parameters    - workingSets - These are the working sets of the processes
+ *                 requester - This is the process that needs frames
+ *                 wanted - This is the number of frames it needs
+ *                 forced - TRUE to ignore working sets
+ * Returns       - Returns the number of frames taken
+ */
+
+int reclaim_frames(workingSetType *workingSets, unsigned int requester, int wanted, BOOLEAN forced)
+{
+	int pid, donor, share, floor, spare, mostSpare, taken=0;
+	BOOLEAN shrunk[MAX_PROCESSES];
+
+	share=fair_share(workingSets);
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		shrunk[pid]=FALSE;
+	}
+	while (taken < wanted) {
+		donor=-1;
+		mostSpare=0;
+		for (pid=0;pid<MAX_PROCESSES;pid++) {
+			if ((pid == (int)requester) || (!workingSets[pid].active)) continue;
+			if ((forced) || (workingSets[pid].workingSetSize > workingSets[pid].frameQuota)) {
+				floor=share;
+			}
+			else {
+				floor=workingSets[pid].workingSetSize;
+				if (floor < MIN_FRAME_QUOTA) floor=MIN_FRAME_QUOTA;
+			}
+			spare=workingSets[pid].frameQuota-floor;
+			if (spare > mostSpare) {
+				donor=pid;
+				mostSpare=spare;
+			}
+		}
+		if (donor == -1) break;
+		workingSets[donor].frameQuota--;
+		shrunk[donor]=TRUE;
+		taken++;
+	}
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		if (shrunk[pid]) {
+			workingSets[pid].quotaDecreases++;
+			if (DEBUG_LEVEL_1) printf("\nProcess %d frame quota shrunk to %d for process %d.", pid, workingSets[pid].frameQuota, requester);
+		}
+	}
+	return taken;
+}
+
+
+/*
+ * Function Name - unassigned_frames
+ * Purpose       - To count the frames that are not in the frame quota of any process
+ * Parameters    - workingSets - These are the working sets of the processes
+ * Returns       - Returns the number of unassigned frames
+ */
+
+int unassigned_frames(workingSetType *workingSets)
+{
+	int pid, frames=FRAME_ENTRIES;
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		frames-=workingSets[pid].frameQuota;
+	}
+	return frames;
+}
+
+
+/*
+ * Function Name - fair_share
+ * Purpose       - To divide the frames evenly between the running processes
+ * Parameters    - workingSets - These are the working sets of the processes
+ * Returns       - Returns the number of frames in a fair share
+ */
+
+int fair_share(workingSetType *workingSets)
+{
+	int pid, processes=0;
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		if (workingSets[pid].active) processes++;
+	}
+	return (processes > 0) ? (FRAME_ENTRIES/processes) : FRAME_ENTRIES;
+}
+
+
+/*
+ * Function Name - total_working_set_size
+ * Purpose       - To add up the working set sizes of every process
+ * Parameters    - workingSets - These are the working sets of the processes
+ * Returns       - Returns the total working set size
+ */
+
+int total_working_set_size(workingSetType *workingSets)
+{
+	int pid, size=0;
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		size+=workingSets[pid].workingSetSize;
+	}
+	return size;
+}
+
+
+/*
+ * Function Name - adjust_frame_quota
+ * Purpose       - At the end of each PFF_INTERVAL of a process, to grow its frame quota up to its working set,
+ *                 or by FRAME_QUOTA_STEP if its page fault frequency is high, from unassigned frames first and
+ *                 then from other processes, and to shrink it to its working set if its page fault frequency
+ *                 is low.  Thrashing is when the fault frequency is high and the working set does not fit in
+ *                 the quota, or for the static pool when the working sets of all processes do not fit in memory.
+ * Parameters    - workingSets - These are the working sets of the processes
+ *                 pid - This is the process that made the reference
+ *                 numAddressLookups - The current reference number, used for reporting
+ * Returns       - Nothing
+ */
+
+void adjust_frame_quota(workingSetType *workingSets, unsigned int pid, int numAddressLookups)
+{
+	workingSetType *workingSet;
+	int target, wanted, frames;
+	BOOLEAN thrashing=FALSE;
+
+	workingSet=&workingSets[pid];
+	if (workingSet->intervalAccesses < PFF_INTERVAL) return;
+
+	if (DEBUG_LEVEL_2) printf("PFF interval ended for process %d, faults=%d, working set=%d, quota=%d.\n",
+			pid, workingSet->intervalFaults, workingSet->workingSetSize, workingSet->frameQuota);
+	if (ADAPTIVE_ALLOCATION) {
+		target=workingSet->workingSetSize;
+		if (target < MIN_FRAME_QUOTA) target=MIN_FRAME_QUOTA;
+		if ((workingSet->intervalFaults > PFF_UPPER_THRESHOLD) && (target < workingSet->frameQuota+FRAME_QUOTA_STEP)) {
+			target=workingSet->frameQuota+FRAME_QUOTA_STEP;
+		}
+		if (target > FRAME_ENTRIES) target=FRAME_ENTRIES;
+		if (target > workingSet->frameQuota) {
+			wanted=target-workingSet->frameQuota;
+			frames=unassigned_frames(workingSets);
+			if (frames > wanted) frames=wanted;
+			if (frames < wanted) {
+				frames+=reclaim_frames(workingSets, pid, wanted-frames, FALSE);
+			}
+			if (frames > 0) {
+				if (DEBUG_LEVEL_1) printf("\nGrowing frame quota of process %d from %d to %d.", pid, workingSet->frameQuota, workingSet->frameQuota+frames);
+				workingSet->frameQuota+=frames;
+				workingSet->quotaIncreases++;
+			}
+		}
+		else if ((workingSet->intervalFaults < PFF_LOWER_THRESHOLD) && (target < workingSet->frameQuota)) {
+			if (DEBUG_LEVEL_1) printf("\nShrinking frame quota of process %d from %d to %d.", pid, workingSet->frameQuota, target);
+			workingSet->frameQuota=target;
+			workingSet->quotaDecreases++;
+		}
+		thrashing=((workingSet->intervalFaults > PFF_UPPER_THRESHOLD) && (workingSet->workingSetSize > workingSet->frameQuota));
+	}
+	else {
+		thrashing=((workingSet->intervalFaults > PFF_UPPER_THRESHOLD) && (total_working_set_size(workingSets) > FRAME_ENTRIES));
+	}
+
+	if (thrashing) {
+		workingSet->thrashingIntervals++;
+		if ((!workingSet->thrashing) && (DEBUG_LEVEL_1)) {
+			printf("\nTHRASHING in process %d at address lookup %d, working set=%d, frame quota=%d, faults in interval=%d.",
+					pid, numAddressLookups, workingSet->workingSetSize, workingSet->frameQuota, workingSet->intervalFaults);
+		}
+	}
+	workingSet->thrashing=thrashing;
+	workingSet->intervalAccesses=0;
+	workingSet->intervalFaults=0;
+}
+
+
+/*
+ * Function Name - print_working_set_stats
+ * Purpose       - To print the working set, frame quota and thrashing statistics of each process at the end
+ *                 of execution
+ * Parameters    - workingSets - These are the working sets of the processes
+ * Returns       - Nothing
+ */
+
+void print_working_set_stats(workingSetType *workingSets)
+{
+	int pid, thrashingIntervals=0;
+	workingSetType *workingSet;
+
+	for (pid=0;pid<MAX_PROCESSES;pid++) {
+		workingSet=&workingSets[pid];
+		if (!workingSet->active) continue;
+		printf("Process %d: average working set size (tau=%d)=%.2f, peak=%d.\n", pid, WS_WINDOW,
+				(workingSet->references > 0) ? ((double)workingSet->workingSetSum/workingSet->references) : 0.0,
+				workingSet->peakWorkingSetSize);
+		if (ADAPTIVE_ALLOCATION) {
+			printf("Process %d: final frame quota=%d, resident frames=%d.\n", pid, workingSet->frameQuota, workingSet->residentFrames);
+			printf("Process %d: frame quota increases=%d, decreases=%d, frames released=%d.\n", pid,
+					workingSet->quotaIncreases, workingSet->quotaDecreases, workingSet->framesReleased);
+		}
+		else {
+			printf("Process %d: resident frames=%d.\n", pid, workingSet->residentFrames);
+		}
+		printf("Process %d: thrashing intervals=%d.\n", pid, workingSet->thrashingIntervals);
+		thrashingIntervals+=workingSet->thrashingIntervals;
+	}
+	if (thrashingIntervals > 0) {
+		printf("WARNING: Thrashing detected, the working sets do not fit in %d frames.\n", FRAME_ENTRIES);
+	}
+}
+
+
+/*
+ * Function Name - print_tier_stats
+ * Purpose       - To print the accesses and cost of each memory tier, and the migration statistics, at the end
+ *                 of execution
+ * Parameters    - physicalMemory - This is the physical memory
+ *                 numAddressLookups - The total number of address lookups
+ * Returns       - Nothing
+ */
+
+void print_tier_stats(physicalMemoryType *physicalMemory, int numAddressLookups)
+{
+	int i;
+	for (i=0;i<MEMORY_TIERS;i++) {
+		printf("Memory tier %d (%d frames, %d ns): accesses=%lld.\n", i, physicalMemory->tierFrames[i],
+				physicalMemory->tierLatency[i], physicalMemory->tierAccesses[i]);
+	}
+	printf("Number of page promotions=%d, demotions=%d.\n", physicalMemory->promotions, physicalMemory->demotions);
+	printf("Memory access cost=%lld ns, average per lookup=%.2f ns.\n", physicalMemory->accessCost,
+			(numAddressLookups > 0) ? ((double)physicalMemory->accessCost/numAddressLookups) : 0.0);
+	printf("Background migration cost=%lld ns.\n", physicalMemory->migrationCost);
+}
+
+
+/*
+ * Function Name - load_trace
+ * Purpose       - To read every virtual address in a trace file into memory, as page numbers.  Both the read
+ *                 ("address") and write ("address R/W") formats are accepted, with an optional process id.
+ * Parameters    - fileName - The trace file
+ *                 pages - Set to the array of page numbers, the caller frees it
+ * Returns       - Returns the number of references read
+ */
+
+unsigned int load_trace(char *fileName, unsigned int **pages)
+{
+	FILE *file;
+	char line[MAX_LINE_LENGTH], accessType;
+	unsigned int numReferences=0, maxReferences=0, *grown, address, pid;
+
+	file=fopen(fileName, "r");
+	if (file == NULL) {
+		printf("ERROR: Unable to open %s.\n", fileName);
+		exit(1);
+	}
+	*pages=NULL;
+	while (fgets(line, MAX_LINE_LENGTH, file) != NULL) {
+		if (!parse_trace_line(line, &address, &accessType, &pid)) continue;
+		if (numReferences == maxReferences) {
+			/* Double the buffer so reading n references copies O(n) of them */
+			maxReferences=(maxReferences == 0) ? OPT_TRACE_CHUNK : (maxReferences*2);
+			if (maxReferences <= numReferences) {
+				printf("ERROR: Too many references in %s.\n", fileName);
+				exit(1);
+			}
+			grown=realloc(*pages, (size_t)maxReferences*sizeof(unsigned int));
+			if (grown == NULL) {
+				printf("ERROR: Out of memory reading %s.\n", fileName);
+				exit(1);
+			}
+			*pages=grown;
+		}
+		(*pages)[numReferences++]=(pid*PAGE_ENTRIES)+extract_pagenumber(address);
+	}
+	fclose(file);
+	if (DEBUG_LEVEL_2) printf("Read %u references from %s.\n", numReferences, fileName);
+	return numReferences;
+}
+
+
+/*
+ * Function Name - build_next_use
+ * Purpose       - To build the next-use index, for each reference the position of the next reference to the
+ *                 same page (or numReferences if it is never used again), in one backwards pass
+ * Parameters    - pages - The page number of each reference
+ *                 nextUse - The next-use index to fill in
+ *                 numReferences - The number of references
+ * Returns       - Nothing
+ */
+
+void build_next_use(unsigned int *pages, unsigned int *nextUse, unsigned int numReferences)
+{
+	unsigned int i, lastSeen[VIRTUAL_PAGES];
+	for (i=0;i<VIRTUAL_PAGES;i++) {
+		lastSeen[i]=numReferences;
+	}
+	for (i=numReferences;i>0;i--) {
+		nextUse[i-1]=lastSeen[pages[i-1]];
+		lastSeen[pages[i-1]]=i-1;
+	}
+}
+
+
+/*
+ * Function Name - simulate_opt
+ * Purpose       - To run Belady's OPT replacement over the trace for a fully associative cache of pages (the
+ *                 frames or a TLB).  Resident pages are kept in a max-heap keyed by next use, entries left
+ *                 behind when a page is used again are skipped when they reach the top, so each eviction is
+ *                 O(log n).
+ * Parameters    - pages - The page number of each reference
+ *                 nextUse - The next-use index
+ *                 numReferences - The number of references
+ *                 capacity - The number of pages that fit
+ * Returns       - Returns the number of misses
+ */
+
+unsigned int simulate_opt(unsigned int *pages, unsigned int *nextUse, unsigned int numReferences, int capacity)
+{
+	BOOLEAN resident[VIRTUAL_PAGES];
+	unsigned int residentNextUse[VIRTUAL_PAGES], i, page, victim, misses=0;
+	int numResident=0;
+	optHeapType heap;
+
+	for (i=0;i<VIRTUAL_PAGES;i++) {
+		resident[i]=FALSE;
+		residentNextUse[i]=0;
+	}
+	heap.size=0;
+	heap.maxSize=(capacity*OPT_HEAP_SLACK)+1;
+	heap.nextUse=malloc(heap.maxSize*sizeof(unsigned int));
+	heap.page=malloc(heap.maxSize*sizeof(unsigned int));
+	if ((heap.nextUse == NULL) || (heap.page == NULL)) {
+		printf("ERROR: Out of memory for OPT heap.\n");
+		exit(1);
+	}
+
+	for (i=0;i<numReferences;i++) {
+		page=pages[i];
+		if (resident[page] == FALSE) {
+			misses++;
+			if (numResident == capacity) {
+				/* Skip entries that are no longer the latest for their page */
+				while ((resident[heap.page[0]] == FALSE) || (residentNextUse[heap.page[0]] != heap.nextUse[0])) {
+					opt_heap_pop(&heap);
+				}
+				victim=heap.page[0];
+				opt_heap_pop(&heap);
+				if (DEBUG_LEVEL_3) printf("OPT evicting page %d, next use %d.\n", victim, residentNextUse[victim]);
+				resident[victim]=FALSE;
+				numResident--;
+			}
+			resident[page]=TRUE;
+			numResident++;
+		}
+		residentNextUse[page]=nextUse[i];
+		if (heap.size == heap.maxSize) {
+			opt_heap_compact(&heap, resident, residentNextUse);
+		}
+		opt_heap_push(&heap, nextUse[i], page);
+	}
+	free(heap.nextUse);
+	free(heap.page);
+	return misses;
+}
+
+
+/*
+ * Function Name - opt_heap_push
+ * Purpose       - To add an entry to the OPT heap
+ * Parameters    - heap - The OPT heap
+ *                 nextUse - The next use of the page, the heap key
+ *                 page - The page
+ * Returns       - Nothing
+ */
+
+void opt_heap_push(optHeapType *heap, unsigned int nextUse, unsigned int page)
+{
+	int i, parent;
+	i=heap->size++;
+	while (i > 0) {
+		parent=(i-1)/2;
+		if (heap->nextUse[parent] >= nextUse) break;
+		heap->nextUse[i]=heap->nextUse[parent];
+		heap->page[i]=heap->page[parent];
+		i=parent;
+	}
+	heap->nextUse[i]=nextUse;
+	heap->page[i]=page;
+}
+
+
+/*
+ * Function Name - opt_heap_pop
+ * Purpose       - To remove the top (furthest next use) entry from the OPT heap
+ * Parameters    - heap - The OPT heap
+ * Returns       - Nothing
+ */
+
+void opt_heap_pop(optHeapType *heap)
+{
+	heap->size--;
+	if (heap->size > 0) {
+		heap->nextUse[0]=heap->nextUse[heap->size];
+		heap->page[0]=heap->page[heap->size];
+		opt_heap_sift_down(heap, 0);
+	}
+}
+
+
+/*
+ * Function Name - opt_heap_sift_down
+ * Purpose       - To move an entry down the OPT heap until both children have an earlier next use
+ * Parameters    - heap - The OPT heap
+ *                 i - The entry to move
+ * Returns       - Nothing
+ */
+
+void opt_heap_sift_down(optHeapType *heap, int i)
+{
+	int child;
+	unsigned int nextUse, page;
+	nextUse=heap->nextUse[i];
+	page=heap->page[i];
+	while ((child=(2*i)+1) < heap->size) {
+		if (((child+1) < heap->size) && (heap->nextUse[child+1] > heap->nextUse[child])) child++;
+		if (heap->nextUse[child] <= nextUse) break;
+		heap->nextUse[i]=heap->nextUse[child];
+		heap->page[i]=heap->page[child];
+		i=child;
+	}
+	heap->nextUse[i]=nextUse;
+	heap->page[i]=page;
+}
+
+
+/*
+ * Function Name - opt_heap_compact
+ * Purpose       - To drop the stale entries from the OPT heap and rebuild it, so it never holds more than
+ *                 OPT_HEAP_SLACK entries per resident page
+ * Parameters    - heap - The OPT heap
+ *                 resident - TRUE for each page that is resident
+ *                 residentNextUse - The latest next use of each resident page
+ * Returns       - Nothing
+ */
+
+void opt_heap_compact(optHeapType *heap, BOOLEAN *resident, unsigned int *residentNextUse)
+{
+	int i, live=0;
+	for (i=0;i<heap->size;i++) {
+		if ((resident[heap->page[i]] == TRUE) && (residentNextUse[heap->page[i]] == heap->nextUse[i])) {
+			heap->nextUse[live]=heap->nextUse[i];
+			heap->page[live]=heap->page[i];
+			live++;
+		}
+	}
+	heap->size=live;
+	for (i=(heap->size/2)-1;i>=0;i--) {
+		opt_heap_sift_down(heap, i);
+	}
+}
+
+
+/*
+ * Function Name - run_opt
+ * Purpose       - To run the offline OPT mode, load the trace, build the next-use index and print the OPT
+ *                 misses for the frames, the L1 TLB and the L1 and L2 TLB together
+ * Parameters    - fileName - The trace file
+ * Returns       - Nothing
+ */
+
+void run_opt(char *fileName)
+{
+	unsigned int *pages, *nextUse, numReferences, tlbMisses, tlbHierarchyMisses, pageFaults;
+
+	numReferences=load_trace(fileName, &pages);
+	nextUse=malloc(((numReferences > 0) ? numReferences : 1)*sizeof(unsigned int));
+	if (nextUse == NULL) {
+		printf("ERROR: Out of memory for next-use index.\n");
+		exit(1);
+	}
+	build_next_use(pages, nextUse, numReferences);
+
+	tlbMisses=simulate_opt(pages, nextUse, numReferences, TLB_ENTRIES);
+	tlbHierarchyMisses=simulate_opt(pages, nextUse, numReferences, TLB_ENTRIES+TLB_L2_ENTRIES);
+	pageFaults=simulate_opt(pages, nextUse, numReferences, FRAME_ENTRIES);
+
+	printf("\nNumber of address lookups=%u.\n", numReferences);
+	printf("Number of OPT TLB misses=%u.\n", tlbMisses);
+	printf("Number of OPT TLB hits=%u.\n", numReferences-tlbMisses);
+	printf("Number of OPT L1+L2 TLB misses (page walks)=%u.\n", tlbHierarchyMisses);
+	printf("Number of OPT L1+L2 TLB hits=%u.\n", numReferences-tlbHierarchyMisses);
+	printf("Number of OPT page faults=%u.\n", pageFaults);
+	printf("Number of OPT references without a page fault=%u.\n", numReferences-pageFaults);
+
+	free(pages);
+	free(nextUse);
 }
 
 
@@ -513,7 +1680,7 @@ void dump_page_table(pageTableType *pageTable)
 	BOOLEAN empty=TRUE;
 
 	if (DEBUG_LEVEL_2) printf("============PAGE TABLE============\n");
-	for (i=0;i<PAGE_ENTRIES;i++) {
+	for (i=0;i<VIRTUAL_PAGES;i++) {
 		if (pageTable->validInvalidBit[i] == TRUE) {
 			if (DEBUG_LEVEL_2) printf("Page Table Entry [%d]=%d, frame=%d\n",i, pageTable->pageTable[i], pageTable->frameTable[i]);
 			empty=FALSE;
@@ -18,6 +18,8 @@
 
 #define PAGE_SIZE 256
 #define PAGE_ENTRIES 256
+#define MAX_PROCESSES 8
+#define VIRTUAL_PAGES (PAGE_ENTRIES*MAX_PROCESSES)
 #define FRAME_SIZE 256
 #define FRAME_ENTRIES 256
 #define MEMORY_SIZE (FRAME_SIZE*FRAME_ENTRIES)
@@ -29,6 +31,111 @@
 #define FALSE 0
 #define READ 0
 #define WRITE 1
+#define OPT 2
+
+/*
+ * Working set estimation and adaptive frame allocation
+ *
+ * Each trace line may end with a process id (0 to MAX_PROCESSES-1), every process has its
+ * own address space and working set.  WS_WINDOW is tau, the working set window measured
+ * in that process's address references.  Every PFF_INTERVAL references of a process its
+ * page fault frequency is sampled.
+ *
+ * With ADAPTIVE_ALLOCATION FALSE every frame is one static pool with global LRU.  With it
+ * TRUE each process has a frame quota, the frames it is guaranteed, starting at a fair share
+ * (FRAME_ENTRIES over the running processes).  At the end of each interval the quota grows
+ * to WS(tau), or by FRAME_QUOTA_STEP if the process faulted more than PFF_UPPER_THRESHOLD
+ * times, and shrinks to WS(tau) if it faulted fewer than PFF_LOWER_THRESHOLD times.  Frames
+ * for a growing quota come from unassigned frames, then from other quotas down to the
+ * owner's working set, or down to its fair share if its working set does not fit its quota
+ * (it is thrashing anyway).  Any process can use free frames.  Once memory is full the LRU
+ * page is replaced from the pages of processes over their quota (or at it, for the faulting
+ * process) and the pages outside their owner's working set.
+ */
+#define ADAPTIVE_ALLOCATION FALSE
+#define WS_WINDOW 200
+#define PFF_INTERVAL 100
+#define PFF_UPPER_THRESHOLD 10
+#define PFF_LOWER_THRESHOLD 2
+#define MIN_FRAME_QUOTA 16
+#define FRAME_QUOTA_STEP 16
+
+#if (MAX_PROCESSES*MIN_FRAME_QUOTA) > FRAME_ENTRIES
+#error "MAX_PROCESSES*MIN_FRAME_QUOTA must not be more than FRAME_ENTRIES"
+#endif
+
+/*
+ * TLB hierarchy and page walk cache
+ *
+ * The L1 dTLB has TLB_ENTRIES entries, the shared L2 TLB has TLB_L2_ENTRIES entries and the
+ * page walk cache has PWC_ENTRIES entries.  Each is split into sets of *_WAYS entries (WAYS
+ * equal to ENTRIES is fully associative).  The page table is walked as PAGE_TABLE_LEVELS
+ * levels, each level below the root is indexed by PAGE_LEVEL_BITS bits of the page number.
+ * The page walk cache holds recently used entries of the upper (non-leaf) levels, a hit
+ * skips the memory references for that level and the levels above it.  Latencies are in
+ * cycles, MEMORY_LATENCY is the cost of each page table memory reference.
+ */
+#define TLB_L1_WAYS 16
+#define TLB_L1_LATENCY 1
+#define TLB_L2_ENTRIES 64
+#define TLB_L2_WAYS 4
+#define TLB_L2_LATENCY 7
+#define PWC_ENTRIES 4
+#define PWC_WAYS 4
+#define PWC_LATENCY 2
+#define PAGE_LEVEL_BITS 4
+#define PAGE_TABLE_LEVELS 2
+#define MEMORY_LATENCY 100
+#define TLB_L1_SETS (TLB_ENTRIES/TLB_L1_WAYS)
+#define TLB_L2_SETS (TLB_L2_ENTRIES/TLB_L2_WAYS)
+#define PWC_SETS (PWC_ENTRIES/PWC_WAYS)
+
+#if (TLB_L1_WAYS < 1) || ((TLB_ENTRIES % TLB_L1_WAYS) != 0)
+#error "TLB_L1_WAYS must divide TLB_ENTRIES"
+#endif
+#if (TLB_L2_WAYS < 1) || ((TLB_L2_ENTRIES % TLB_L2_WAYS) != 0)
+#error "TLB_L2_WAYS must divide TLB_L2_ENTRIES"
+#endif
+#if (PWC_WAYS < 1) || ((PWC_ENTRIES % PWC_WAYS) != 0)
+#error "PWC_WAYS must divide PWC_ENTRIES"
+#endif
+#if PAGE_TABLE_LEVELS < 1
+#error "PAGE_TABLE_LEVELS must be at least 1"
+#endif
+
+/*
+ * Offline OPT (Belady) replacement
+ *
+ * The trace is read into a buffer of OPT_TRACE_CHUNK references, doubled when full.  The
+ * eviction heap is rebuilt from its live entries when it holds more than
+ * OPT_HEAP_SLACK times the number of resident entries.
+ */
+#define OPT_TRACE_CHUNK 1048576
+#define OPT_HEAP_SLACK 4
+#define MAX_LINE_LENGTH 256
+
+/*
+ * Tiered physical memory
+ *
+ * The frames are split into MEMORY_TIERS tiers, fastest first from frame 0.  TIER_FRAMES and
+ * TIER_LATENCIES list the frames and the cost of one access (in ns) of each tier, the frames
+ * must add up to FRAME_ENTRIES (checked at start up).  The defaults are DRAM and CXL/PMEM.
+ * Every MIGRATION_INTERVAL references, for each pair of adjacent tiers, up to MIGRATION_BATCH
+ * hot pages (accessed at least HOT_THRESHOLD times since the last pass) are promoted from the
+ * slower tier into the faster one, demoting its coldest pages, then the access counts are
+ * halved.  Each page moved costs MIGRATION_COST ns in the background.
+ */
+#define MEMORY_TIERS 2
+#define TIER_FRAMES { FRAME_ENTRIES/4, FRAME_ENTRIES-(FRAME_ENTRIES/4) }
+#define TIER_LATENCIES { 80, 250 }
+#define MIGRATION_INTERVAL 100
+#define MIGRATION_BATCH 8
+#define HOT_THRESHOLD 2
+#define MIGRATION_COST 1000
+
+#if MEMORY_TIERS < 1
+#error "MEMORY_TIERS must be at least 1"
+#endif
 
 /* DEBUG LEVEL is defined as follows:
  * The higher the level that is TRUE, the more detailed DEBUGGING
@@ -38,15 +145,35 @@
 #define DEBUG_LEVEL_3 FALSE
 
 /*
- * This is my TLB
+ * This is my TLB, the L1 dTLB entries followed by the L2 TLB entries
  */
 typedef struct tlbEntrys {
 	    BOOLEAN inUse[TLB_ENTRIES];
     	unsigned int page[TLB_ENTRIES];
     	unsigned int frame[TLB_ENTRIES];
     	unsigned int numTimesUsed[TLB_ENTRIES];
+    	BOOLEAN l2InUse[TLB_L2_ENTRIES];
+    	unsigned int l2Page[TLB_L2_ENTRIES];
+    	unsigned int l2Frame[TLB_L2_ENTRIES];
+    	unsigned int l2LastUsed[TLB_L2_ENTRIES];
+    	unsigned int l2Clock;
 } tlbType;
 
+/*
+ * This is my page walk cache, it holds upper level page table entries, tagged by the
+ * level and the page number bits that index down to that level
+ */
+typedef struct pageWalkCacheEntries {
+	BOOLEAN inUse[PWC_ENTRIES];
+	int level[PWC_ENTRIES];
+	unsigned int prefix[PWC_ENTRIES];
+	unsigned int lastUsed[PWC_ENTRIES];
+	unsigned int clock;
+	int hits;
+	int misses;
+	int memoryReferences;
+} pageWalkCacheType;
+
 /*
  * This represents my physical memory
  */
@@ -55,7 +182,16 @@ typedef struct memoryLocations {
 	int numTimesAccessed[FRAME_ENTRIES];
 	BOOLEAN dirty[FRAME_ENTRIES];
 	int lruCounter[FRAME_ENTRIES];
+	unsigned int pageInFrame[FRAME_ENTRIES];
 	char physicalMemory[MEMORY_SIZE];
+	int tierFirstFrame[MEMORY_TIERS];
+	int tierFrames[MEMORY_TIERS];
+	int tierLatency[MEMORY_TIERS];
+	long long tierAccesses[MEMORY_TIERS];
+	long long accessCost;
+	long long migrationCost;
+	int promotions;
+	int demotions;
 
 } physicalMemoryType;
 
@@ -63,29 +199,100 @@ typedef struct memoryLocations {
  * This is my page table
  */
 typedef struct pageTableEntries {
-	unsigned int pageTable[PAGE_ENTRIES];
-	unsigned int frameTable[PAGE_ENTRIES];
-	BOOLEAN validInvalidBit[PAGE_ENTRIES];
+	unsigned int pageTable[VIRTUAL_PAGES];
+	unsigned int frameTable[VIRTUAL_PAGES];
+	BOOLEAN validInvalidBit[VIRTUAL_PAGES];
 } pageTableType;
 
+/*
+ * This is the working set of an address space, it tracks WS(tau) over a sliding
+ * window of references, the page fault frequency, and the frame quota it is allowed
+ */
+typedef struct workingSetEntries {
+	BOOLEAN active;
+	int references;
+	unsigned int window[WS_WINDOW];
+	int windowCount[PAGE_ENTRIES];
+	int windowNext;
+	int windowFill;
+	int workingSetSize;
+	int peakWorkingSetSize;
+	long workingSetSum;
+	int frameQuota;
+	int residentFrames;
+	int intervalAccesses;
+	int intervalFaults;
+	BOOLEAN thrashing;
+	int thrashingIntervals;
+	int quotaIncreases;
+	int quotaDecreases;
+	int framesReleased;
+} workingSetType;
+
+/*
+ * This is my OPT eviction heap, a max-heap of resident entries keyed by their next use
+ */
+typedef struct optHeapEntries {
+	unsigned int *nextUse;
+	unsigned int *page;
+	int size;
+	int maxSize;
+} optHeapType;
+
 /*
  * These are my function prototypes, please see primary code for comments
  */
-void initialize(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb);
+void initialize(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb, workingSetType *workingSets,
+		pageWalkCacheType *pageWalkCache);
+BOOLEAN parse_trace_line(char *line, unsigned int *address, char *accessType, unsigned int *pid);
 void insert_tlb(tlbType *tlb, unsigned int pageNumber, unsigned int currentFrame);
+void insert_tlb_l2(tlbType *tlb, unsigned int pageNumber, unsigned int currentFrame);
+int lookup_tlb_l2(tlbType *tlb, unsigned int pageNumber);
+int page_walk(pageWalkCacheType *pageWalkCache, unsigned int pageNumber);
+BOOLEAN lookup_pwc(pageWalkCacheType *pageWalkCache, int level, unsigned int prefix);
+void insert_pwc(pageWalkCacheType *pageWalkCache, int level, unsigned int prefix);
+void invalidate_tlb(tlbType *tlb, unsigned int pageNumber);
 int lookup_tlb(tlbType *tlb, unsigned int pageNumber);
 int lookup_frame(pageTableType *pageTable, unsigned int pageNumber);
-int least_used_tlb_entry(tlbType *tlb);
-unsigned int find_lru_frame(physicalMemoryType *physicalMemory);
+int least_used_tlb_entry(tlbType *tlb, unsigned int pageNumber);
+unsigned int find_lru_frame(physicalMemoryType *physicalMemory, int pid);
 void dump_tlb(tlbType *tlb);
 void dump_page_table(pageTableType *pageTable);
 void dump_physical_memory(physicalMemoryType *physicalMemory);
-void page_fault(pageTableType *pageTable, unsigned int pageNumber, physicalMemoryType *physicalMemory, unsigned int *currentFrame);
+void page_fault(pageTableType *pageTable, unsigned int pageNumber, physicalMemoryType *physicalMemory, tlbType *tlb,
+		workingSetType *workingSets, unsigned int *currentFrame);
+void evict_frame(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb,
+		workingSetType *workingSets, unsigned int frame);
+void activate_process(workingSetType *workingSets, unsigned int pid);
+int reclaim_frames(workingSetType *workingSets, unsigned int requester, int wanted, BOOLEAN forced);
+int unassigned_frames(workingSetType *workingSets);
+int fair_share(workingSetType *workingSets);
+unsigned int find_over_quota_lru_frame(physicalMemoryType *physicalMemory, workingSetType *workingSets,
+		unsigned int faulting);
+int total_working_set_size(workingSetType *workingSets);
+void update_working_set(workingSetType *workingSet, unsigned int pageNumber, BOOLEAN pageFault);
+void adjust_frame_quota(workingSetType *workingSets, unsigned int pid, int numAddressLookups);
+void print_working_set_stats(workingSetType *workingSets);
 void showbits(unsigned int x);
 void showbitschar(char x);
 unsigned int extract_pagenumber(unsigned int address);
 unsigned int extract_offset(unsigned int address);
 void load_page_from_backing_store(unsigned int pageNumber, physicalMemoryType *physicalMemory, unsigned int *currentFrame);
+unsigned int find_free_frame(physicalMemoryType *physicalMemory);
+int frame_tier(physicalMemoryType *physicalMemory, unsigned int frame);
+void record_memory_access(physicalMemoryType *physicalMemory, unsigned int frame);
+void migrate_pages(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb);
+void swap_frames(pageTableType *pageTable, physicalMemoryType *physicalMemory, tlbType *tlb,
+		unsigned int fromFrame, unsigned int toFrame);
+void print_tier_stats(physicalMemoryType *physicalMemory, int numAddressLookups);
 void print_page(char *page);
+unsigned int load_trace(char *fileName, unsigned int **pages);
+void build_next_use(unsigned int *pages, unsigned int *nextUse, unsigned int numReferences);
+unsigned int simulate_opt(unsigned int *pages, unsigned int *nextUse, unsigned int numReferences, int capacity);
+void opt_heap_push(optHeapType *heap, unsigned int nextUse, unsigned int page);
+void opt_heap_pop(optHeapType *heap);
+void opt_heap_sift_down(optHeapType *heap, int i);
+void opt_heap_compact(optHeapType *heap, BOOLEAN *resident, unsigned int *residentNextUse);
+void run_opt(char *fileName);
 
 #endif /* VMM_H_ */